@@ -5,6 +5,9 @@
 #include "src/field.h"
 #include "src/parser.h"
 #include "src/typesAndField.h"
+#include "src/golden.h"
+#include "src/autoTune.h"
+#include "src/server.h"
 
 auto simulators = generateSimulators();
 auto types = generateTypes();
@@ -12,38 +15,89 @@ auto types = generateTypes();
 using json = nlohmann::json;
 
 bool save = false;
+bool stop = false;
 
 void handler(int x) {
     save = true;
 }
 
+void stopHandler(int x) {
+    stop = true;
+}
+
 int main(int argc, char* argv[]) {
     signal(SIGINT, handler);
+    signal(SIGQUIT, stopHandler);
+    signal(SIGTERM, stopHandler);
 
     Parser parser{};
     parser.parseArgs(argc, argv);
     std::cout << parser.p_type << parser.v_type << parser.vf_type << std::endl;
 
+    planeMemory.huge_pages = parser.huge_pages;
+    planeMemory.pin_threads = parser.pin_threads;
+    if (parser.pin_threads) {
+        pinThread(0);
+    }
+
+    if (!parser.serve_path.empty()) {
+        return runServer(types, simulators, parser, stop);
+    }
+
     FieldConfig info(parser.input_filename);
 
-    tuple need = {parser.p_type, parser.v_type, parser.vf_type, info.h, info.w};
-    auto index = std::find(types.begin(), types.end(), need) - types.begin();
-    if (index == types.size()) {
-        need = {parser.p_type, parser.v_type, parser.vf_type, 0, 0};
-        index = std::find(types.begin(), types.end(), need) - types.begin();
+    if (!parser.golden_filename.empty()) {
+        return runGolden(types, simulators, info, parser);
     }
+
+    if (parser.auto_types) {
+        auto [p, v, vf] = autoTune(types, simulators, info, parser);
+        parser.p_type = p; parser.v_type = v; parser.vf_type = vf;
+    }
+
+    auto index = findSimulator(types, parser.p_type, parser.v_type, parser.vf_type, info.h, info.w, parser.sparse);
     if (index == types.size()) {
         std::cout << "Simulator with chosen types does not exist\n";
+        if (parser.sparse) std::cout << "Sparse storage is only built for P, V and VF of the same type\n";
         exit(EXIT_FAILURE);
     }
 
+    auto [p_type, v_type, vf_type, n_bucket, k_bucket] = types[index];
+    if (n_bucket == 0) {
+        std::cout << "Size bucket: dynamic for " << info.h << "x" << info.w << "\n";
+    } else if (n_bucket > 0) {
+        double overhead = double(n_bucket * k_bucket) / double(info.h * info.w) - 1.0;
+        std::cout << "Size bucket: " << n_bucket << "x" << k_bucket << " for " << info.h << "x" << info.w
+                  << ", padding overhead " << int(overhead * 100 + 0.5) << "%\n";
+    }
+
 //    auto& field = simulators[index];
     auto field = simulators[index]();
     field->init(info, parser);
+    field->reportStorage(std::cout);
+
+    if (!parser.trace_filename.empty()) {
+        tracer.start(parser.trace_filename);
+        tracer.nameThread("compute");
+    }
+
+    auto output = std::make_unique<OutputPipeline>(parser.drop_frames ? OutputPolicy::DROP : OutputPolicy::BLOCK);
+    field->output = output.get();
+    if (parser.pin_threads) {
+        // The writer inherited the compute thread's mask, move it off that core.
+        pinThread(1, output->worker.native_handle());
+    }
+
+    TlbCounter tlb;
+    tlb.start();
+    auto start = std::chrono::steady_clock::now();
+    size_t ticks = 0;
 
-    for (size_t i = info.tick; i < 1000000; ++i) {
+    for (size_t i = info.tick; i < 1000000 && !stop; ++i, ++ticks) {
         if (save) {
             field->save(parser.output_filename, i);
+            output->flush();
+            auto paused = std::chrono::steady_clock::now();
 
             std::cout << "Enter any number to continue: ";
 
@@ -52,8 +106,20 @@ int main(int argc, char* argv[]) {
             std::cin >> tmp;
 
             std::cout << std::endl;
+            start += std::chrono::steady_clock::now() - paused;
         }
 
         field->nextTick(i);
     }
-}
\ No newline at end of file
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    int64_t tlb_misses = tlb.stop();
+
+    size_t dropped = output->dropped, stalls = output->stalls;
+    output.reset();
+    tracer.write();
+    reportPlaneMemory(std::cout, tlb_misses, ticks, elapsed.count());
+    std::cout << "Output: " << (parser.drop_frames ? "drop" : "block") << " policy, " << dropped
+              << " frames dropped, " << stalls << " stalls on a full queue\n";
+    field->reportStorage(std::cout);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+#include "trial.h"
+
+// Thresholds for a combination to count as adequate against the DOUBLE reference.
+constexpr double tune_mismatch_limit = 0.02;
+constexpr double tune_pressure_limit = 0.05;
+// Every candidate is timed as the best of several runs, and a non-DOUBLE choice has to
+// beat DOUBLE by this factor, so run-to-run noise does not pick (and cache) a winner.
+constexpr int tune_repeats = 3;
+constexpr double tune_min_speedup = 1.1;
+
+struct TypeChoice {
+    int p = 0, v = 0, vf = 0;
+};
+
+template <typename Types, typename Simulators>
+TypeChoice autoTune(const Types& types, const Simulators& simulators, const FieldConfig& info, const Parser& parser) {
+    // A choice only holds for the scene content, trial length and solver mode it was tuned on.
+    std::string key = std::to_string(sceneHash(parser.input_filename)) + "," + std::to_string(parser.tune_ticks) + "," +
+                      trialMode(parser);
+
+    if (parser.p_type || parser.v_type || parser.vf_type) {
+        std::cout << "Auto types: overriding the types given by --p-type/--v-type/--vf-type\n";
+    }
+
+    nlohmann::json cache = nlohmann::json::object();
+    {
+        std::ifstream in(parser.tune_cache_filename);
+        if (in.is_open()) in >> cache;
+    }
+
+    if (cache.contains(key)) {
+        auto& entry = cache[key];
+        std::string p = entry.value("p", ""), v = entry.value("v", ""), vf = entry.value("vf", "");
+        TypeChoice c{getTypeFromName(p), getTypeFromName(v), getTypeFromName(vf)};
+        if (findSimulator(types, c.p, c.v, c.vf, info.h, info.w, parser.sparse) != types.size()) {
+            std::cout << "Auto types: " << getNameFromType(c.p) << "," << getNameFromType(c.v) << ","
+                      << getNameFromType(c.vf) << " (cached)\n";
+            return c;
+        }
+    }
+
+    TypeChoice best{DOUBLE, DOUBLE, DOUBLE};
+    size_t ref_index = findSimulator(types, DOUBLE, DOUBLE, DOUBLE, info.h, info.w, parser.sparse);
+    if (ref_index == types.size()) {
+        throw std::runtime_error("Auto types need DOUBLE in TYPES as the reference");
+    }
+
+    TrialResult ref = bestTrial(simulators[ref_index], info, parser.tune_ticks, parser, tune_repeats);
+    if (!ref.ok) {
+        throw std::runtime_error("Auto types: reference DOUBLE trial failed");
+    }
+
+    double ref_rms = 0;
+    size_t cells = 0;
+    for (size_t i = 0; i < ref.cells.size(); i++) {
+        if (ref.cells[i] == '#') continue;
+        ref_rms += ref.pressure[i] * ref.pressure[i];
+        cells++;
+    }
+    ref_rms = cells ? std::sqrt(ref_rms / cells) : 0;
+
+    double best_tps = ref.ticks_per_sec, ref_tps = ref.ticks_per_sec;
+    std::cout << "Auto types: tuning on " << parser.tune_ticks << " ticks\n";
+    for (int p: t) {
+        for (int v: t) {
+            for (int vf: t) {
+                size_t index = findSimulator(types, p, v, vf, info.h, info.w, parser.sparse);
+                if (index == types.size() || index == ref_index) continue;
+
+                TrialResult r = bestTrial(simulators[index], info, parser.tune_ticks, parser, tune_repeats);
+                if (!r.ok) continue;
+
+                Accuracy acc = compareTrial(ref, r, info);
+                double pressure_rel = ref_rms > 0 ? acc.pressure_l2 / ref_rms : acc.pressure_l2;
+                bool adequate = acc.mismatch <= tune_mismatch_limit && pressure_rel <= tune_pressure_limit;
+                if (adequate && r.ticks_per_sec > best_tps && r.ticks_per_sec >= ref_tps * tune_min_speedup) {
+                    best = {p, v, vf};
+                    best_tps = r.ticks_per_sec;
+                }
+            }
+        }
+    }
+
+    std::cout << "Auto types: " << getNameFromType(best.p) << "," << getNameFromType(best.v) << ","
+              << getNameFromType(best.vf) << " (" << best_tps << " ticks/s)\n";
+
+    cache[key] = {{"p", getNameFromType(best.p)}, {"v", getNameFromType(best.v)}, {"vf", getNameFromType(best.vf)},
+                  {"scene", parser.input_filename}};
+    std::ofstream out(parser.tune_cache_filename);
+    if (out.is_open()) {
+        out << cache.dump(4);
+    }
+    return best;
+}
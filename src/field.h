@@ -4,11 +4,14 @@
 #include <algorithm>
 #include <cstring>
 #include <fstream>
+#include <sstream>
 
 #include "utils.h"
 #include "vectorField.h"
 #include "wrapperArray.h"
 #include "parser.h"
+#include "outputPipeline.h"
+#include "trace.h"
 
 using std::tuple, std::pair, std::ofstream;
 using json = nlohmann::json;
@@ -55,9 +58,14 @@ struct FieldConfig {
 };
 
 struct AbstractField {
+    OutputPipeline* output = nullptr;
+
     virtual void nextTick(int i) = 0;
     virtual void init(const FieldConfig& f, const Parser& parser) = 0;
     virtual void save(const std::string& filename, size_t i) = 0;
+    virtual void exportState(std::string& cells, std::vector<double>& pressure) const = 0;
+    virtual void setCell(int x, int y, char c) = 0;
+    virtual void reportStorage(std::ostream& out) const = 0;
     virtual ~AbstractField() = default;
 };
 
@@ -75,60 +83,102 @@ struct Field final: AbstractField {
     Array<int64_t, N_val, K_val> last_use{}, dirs{};
     int UT = 0;
 
+    // Positive velocities towards non-wall neighbours (zero otherwise) and their running sums,
+    // valid for the move phase: filled after recalculate_p and patched on swap.
+    struct Outgoing {
+        std::array<VType, deltas.size()> v;
+        std::array<VType, deltas.size()> prefix;
+    };
+    Array<Outgoing, N_val, K_val> outgoing{};
+
     PType rho[256];
     Array<PType, N_val, K_val> p{}, old_p{};
     VType g{};
+
+    // Implicit pressure mode: fluid pressure is solved each tick from the Poisson equation
+    // whose solution cancels gravity at rest (walls are Neumann, air is p = 0 Dirichlet).
+    static constexpr double implicit_tolerance = 1e-6;
+    static constexpr int implicit_max_iterations = 256;
+    // Solver planes, allocated only in implicit mode so explicit fields stay their original size.
+    struct Solver {
+        Array<double, N_val, K_val> x{}, b{}, r{}, z{}, d{}, q{};
+
+        static void* operator new(size_t size) {return allocatePlane(size);}
+        static void operator delete(void* ptr, size_t size) {freePlane(ptr, size);}
+    };
+    bool implicit_p = false;
+    std::unique_ptr<Solver> cg;
+    // Per field, so warm fields in one process do not perturb each other's runs.
     std::mt19937 rnd;
 
     Field(): rnd(1337) {}
 
+    // Static buckets keep their planes inline, so the whole field goes through the plane allocator.
+    static void* operator new(size_t size) {return allocatePlane(size);}
+    static void operator delete(void* ptr, size_t size) {freePlane(ptr, size);}
+
     void nextTick(int i) override {
+        TRACE_SCOPE("tick", i);
         PType total_delta_p = int64_t(0);
 
         apply_external_forces();
 
+        if (implicit_p) {
+            solve_p_implicit(total_delta_p);
+        }
+
         apply_forces_from_p(total_delta_p);
 
         make_flow_from_velocities();
 
         recalculate_p(total_delta_p);
 
-        if (apply_move_on_flow()) {
-            std::cout << "Tick " << i << ":\n";
-            for (int j = 0; j < N; j++) {
-                for (int k = 0; k < K; k++) {
-                    std::cout << field[j][k];
-                }
-                std::cout << "\n";
+        cache_outgoing();
+
+        if (apply_move_on_flow() && output) {
+            if (Snapshot* s = output->acquire(OutputKind::TICK)) {
+                fill_snapshot(*s, OutputKind::TICK, i);
+                output->publish();
             }
-            std::cout.flush();
         }
 
         if (!out_name.empty() && (++cur_tick == n_ticks)) {
-            ofstream out(out_name);
+            Snapshot local;
+            Snapshot* s = output ? output->acquire(OutputKind::DUMP) : &local;
+            fill_snapshot(*s, OutputKind::DUMP, i);
+            s->filename = out_name;
 
+            std::ostringstream head;
             auto cnt = std::count_if(rho, rho+256, [](auto i){return i != int64_t(0);});
 
-            out << N << " " << K << " " << g << " " << cnt << "\n";
+            head << N << " " << K << " " << g << " " << cnt << "\n";
             for (int i = 0; i < 256; i++) {
                 if (rho[i] == int64_t(0)) continue;
-                out << ((uint8_t)i) << " " << rho[i] << "\n";
+                head << ((uint8_t)i) << " " << rho[i] << "\n";
             }
+            s->header = head.str();
 
-            for (int x = 0; x < N; x++)
-            {
-                for (int y = 0; y < K; y++)
-                {
-                    out << field[x][y];
-                }
-                out << "\n";
+            if (output) {
+                output->publish();
+            } else {
+                writeSnapshot(local);
             }
-            out.close();
 
             cur_tick = 0;
         }
     };
 
+    void fill_snapshot(Snapshot& s, OutputKind kind, size_t i) const {
+        s.kind = kind; s.tick = i;
+        s.N = N; s.K = K;
+        s.cells.resize(size_t(N) * K);
+        for (int x = 0; x < N; x++) {
+            for (int y = 0; y < K; y++) {
+                s.cells[size_t(x) * K + y] = field[x][y];
+            }
+        }
+    };
+
     void init(const FieldConfig& f, const Parser& parser) override {
         g = f.g; N = f.h; K = f.w;
         rho[' '] = f.rhoField;
@@ -138,17 +188,35 @@ struct Field final: AbstractField {
         velocity_flow.init(N, K);
         p.init(N, K); old_p.init(N, K);
         last_use.init(N, K); dirs.init(N, K);
+        outgoing.init(N, K);
         field.init(N, K);
 
+        if constexpr (N_val > 0) {
+            for (size_t i = 0; i < N_val; i++) {
+                std::fill_n(field[i], K_val, '#');
+            }
+        }
+
         for (size_t i = 0; i < N; i++) {
             for (size_t j = 0; j < K; j++) {
                 field[i][j] = f.field[i][j];
             }
         }
 
+        if constexpr (N_val < 0) {
+            field.seal('#');
+        }
+
         n_ticks = parser.n_ticks;
         out_name = parser.output_filename;
 
+        implicit_p = parser.implicit_pressure;
+        if (implicit_p) {
+            cg = std::make_unique<Solver>();
+            cg->x.init(N, K); cg->b.init(N, K); cg->r.init(N, K);
+            cg->z.init(N, K); cg->d.init(N, K); cg->q.init(N, K);
+        }
+
         for (size_t x = 0; x < N; ++x) {
             for (size_t y = 0; y < K; ++y) {
                 if (field[x][y] == '#')
@@ -160,12 +228,36 @@ struct Field final: AbstractField {
         }
     };
 
+    // Visits cells in row-major order, skipping sealed all-wall tiles of sparse storage.
+    template <typename F>
+    void for_cells(F&& f) const {
+        if constexpr (N_val < 0) {
+            for (int x = 0; x < N; ++x) {
+                for (int ty = 0; ty < field.TK; ++ty) {
+                    if (field.sealed(x, ty))
+                        continue;
+                    int end = std::min(K, (ty + 1) * SPARSE_TILE);
+                    for (int y = ty * SPARSE_TILE; y < end; ++y) {
+                        f(x, y);
+                    }
+                }
+            }
+        } else {
+            for (size_t x = 0; x < N; ++x) {
+                for (size_t y = 0; y < K; ++y) {
+                    f(x, y);
+                }
+            }
+        }
+    };
+
     void propagate_stop(int x, int y, bool force = false) {
         if (!force) {
+            const Outgoing& o = outgoing[x][y];
             bool stop = true;
-            for (auto [dx, dy]: deltas) {
-                int nx = x + dx, ny = y + dy;
-                if (field[nx][ny] != '#' && last_use[nx][ny] < UT - 1 && velocity.get(x, y, dx, dy) > int64_t(0)) {
+            for (size_t i = 0; i < deltas.size(); ++i) {
+                auto [dx, dy] = deltas[i];
+                if (o.v[i] > int64_t(0) && last_use[x + dx][y + dy] < UT - 1) {
                     stop = false;
                     break;
                 }
@@ -184,29 +276,65 @@ struct Field final: AbstractField {
         }
     };
 
-    VType move_prob(int x, int y) {
-        VType sum;
+    // Fills tres with the running sums of outgoing velocities towards cells not yet used in this pass.
+    VType outgoing_sums(int x, int y, std::array<VType, deltas.size()>& tres) const {
+        const Outgoing& o = outgoing[x][y];
+        bool all_free = true;
         for (size_t i = 0; i < deltas.size(); ++i) {
             auto [dx, dy] = deltas[i];
-            int nx = x + dx, ny = y + dy;
-            if (field[nx][ny] == '#' || last_use[nx][ny] == UT) {
-                continue;
+            if (o.v[i] > int64_t(0) && last_use[x + dx][y + dy] == UT) {
+                all_free = false;
+                break;
             }
+        }
+        if (all_free) {
+            tres = o.prefix;
+            return o.prefix.back();
+        }
 
-            VType v = velocity.get(x, y, dx, dy);
-            if (v < int64_t(0)) {
-                continue;
+        VType sum{};
+        for (size_t i = 0; i < deltas.size(); ++i) {
+            auto [dx, dy] = deltas[i];
+            if (o.v[i] > int64_t(0) && last_use[x + dx][y + dy] != UT) {
+                sum += o.v[i];
             }
-
-            sum += v;
+            tres[i] = sum;
         }
         return sum;
     };
 
+    VType move_prob(int x, int y) const {
+        std::array<VType, deltas.size()> tres;
+        return outgoing_sums(x, y, tres);
+    };
+
+    void update_outgoing(int x, int y) {
+        Outgoing& o = outgoing[x][y];
+        VType sum{};
+        for (size_t i = 0; i < deltas.size(); ++i) {
+            auto [dx, dy] = deltas[i];
+            VType v = velocity.v[x][y][i];
+            o.v[i] = (field[x + dx][y + dy] != '#' && !(v < int64_t(0))) ? v : VType{};
+            sum += o.v[i];
+            o.prefix[i] = sum;
+        }
+    };
+
+    void cache_outgoing() {
+        TRACE_SCOPE("cache_outgoing");
+        for_cells([&](size_t x, size_t y) {
+            if (field[x][y] == '#')
+                return;
+            update_outgoing(x, y);
+        });
+    };
+
     void swap(int x1, int y1, int x2, int y2) {
         std::swap(field[x1][y1], field[x2][y2]);
         std::swap(p[x1][y1], p[x2][y2]);
         std::swap(velocity.v[x1][y1], velocity.v[x2][y2]);
+        update_outgoing(x1, y1);
+        update_outgoing(x2, y2);
     };
 
     std::tuple<VFType, bool, std::pair<int, int>> propagate_flow(int x, int y, VFType lim) {
@@ -246,28 +374,13 @@ struct Field final: AbstractField {
         int nx = -1, ny = -1;
         do {
             std::array<VType, deltas.size()> tres;
-            VType sum;
-            for (size_t i = 0; i < deltas.size(); ++i) {
-                auto [dx, dy] = deltas[i];
-                int nx = x + dx, ny = y + dy;
-                if (field[nx][ny] == '#' || last_use[nx][ny] == UT) {
-                    tres[i] = sum;
-                    continue;
-                }
-                VType v = velocity.get(x, y, dx, dy);
-                if (v < int64_t(0)) {
-                    tres[i] = sum;
-                    continue;
-                }
-                sum += v;
-                tres[i] = sum;
-            }
+            VType sum = outgoing_sums(x, y, tres);
 
             if (sum == int64_t(0)) {
                 break;
             }
 
-            VType p = random01<VType>() * sum;
+            VType p = random01<VType>(rnd) * sum;
             size_t d = std::ranges::upper_bound(tres, p) - tres.begin();
 
             auto [dx, dy] = deltas[d];
@@ -294,133 +407,262 @@ struct Field final: AbstractField {
     };
 
     void apply_external_forces() {
-        for (size_t x = 0; x < N; ++x) {
-            for (size_t y = 0; y < K; ++y) {
-                if (field[x][y] == '#')
-                    continue;
-                if (field[x + 1][y] != '#')
-                    velocity.add(x, y, 1, 0, g);
-            }
-        }
+        TRACE_SCOPE("apply_external_forces");
+        for_cells([&](size_t x, size_t y) {
+            if (field[x][y] == '#')
+                return;
+            if (field[x + 1][y] != '#')
+                velocity.add(x, y, 1, 0, g);
+        });
     };
 
     void apply_forces_from_p(PType &total_delta_p) {
+        TRACE_SCOPE("apply_forces_from_p");
         old_p = p;
-        for (size_t x = 0; x < N; ++x) {
-            for (size_t y = 0; y < K; ++y) {
-                if (field[x][y] == '#')
-                    continue;
-                for (auto [dx, dy]: deltas) {
-                    int nx = x + dx, ny = y + dy;
-                    if (field[nx][ny] != '#' && old_p[nx][ny] < old_p[x][y]) {
-                        PType delta_p = old_p[x][y] - old_p[nx][ny];
-                        PType force = delta_p;
-                        VType &contr = velocity.get(nx, ny, -dx, -dy);
-                        if (PType(contr) * rho[(int) field[nx][ny]] >= force) {
-                            contr -= VType(force / rho[(int) field[nx][ny]]);
-                            continue;
-                        }
-                        force -= PType(contr) * rho[(int) field[nx][ny]];
-                        contr = int64_t(0);
-                        velocity.add(x, y, dx, dy, VType(force / rho[(int) field[x][y]]));
-                        p[x][y] -= force / PType(dirs[x][y]);
-                        total_delta_p -= force / PType(dirs[x][y]);
+        for_cells([&](size_t x, size_t y) {
+            if (field[x][y] == '#')
+                return;
+            for (auto [dx, dy]: deltas) {
+                int nx = x + dx, ny = y + dy;
+                if (field[nx][ny] != '#' && old_p[nx][ny] < old_p[x][y]) {
+                    PType delta_p = old_p[x][y] - old_p[nx][ny];
+                    PType force = delta_p;
+                    VType &contr = velocity.get(nx, ny, -dx, -dy);
+                    if (PType(contr) * rho[(int) field[nx][ny]] >= force) {
+                        contr -= VType(force / rho[(int) field[nx][ny]]);
+                        continue;
                     }
+                    force -= PType(contr) * rho[(int) field[nx][ny]];
+                    contr = int64_t(0);
+                    velocity.add(x, y, dx, dy, VType(force / rho[(int) field[x][y]]));
+                    p[x][y] -= force / PType(dirs[x][y]);
+                    total_delta_p -= force / PType(dirs[x][y]);
                 }
             }
+        });
+    };
+
+    // Fluid cells walled in on all sides have dirs == 0 and are left out of the system.
+    bool in_p_system(size_t x, size_t y) const {
+        return field[x][y] == '.' && dirs[x][y] != 0;
+    };
+
+    void apply_p_operator(const Array<double, N_val, K_val>& src, Array<double, N_val, K_val>& dst) const {
+        for_cells([&](size_t x, size_t y) {
+            if (!in_p_system(x, y))
+                return;
+            double neighbours = 0;
+            for (auto [dx, dy]: deltas) {
+                if (in_p_system(x + dx, y + dy))
+                    neighbours += src[x + dx][y + dy];
+            }
+            dst[x][y] = double(dirs[x][y]) * src[x][y] - neighbours;
+        });
+    };
+
+    double dot_p(const Array<double, N_val, K_val>& a, const Array<double, N_val, K_val>& b) const {
+        double sum = 0;
+        for_cells([&](size_t x, size_t y) {
+            if (in_p_system(x, y))
+                sum += a[x][y] * b[x][y];
+        });
+        return sum;
+    };
+
+    void solve_p_implicit(PType &total_delta_p) {
+        TRACE_SCOPE("solve_p_implicit");
+        auto &cg_x = cg->x, &cg_b = cg->b, &cg_r = cg->r, &cg_z = cg->z, &cg_d = cg->d, &cg_q = cg->q;
+        double weight = double(rho['.']) * double(g);
+        for_cells([&](size_t x, size_t y) {
+            if (!in_p_system(x, y))
+                return;
+            cg_x[x][y] = double(p[x][y]);
+            cg_b[x][y] = weight * (int(field[x - 1][y] != '#') - int(field[x + 1][y] != '#'));
+        });
+
+        apply_p_operator(cg_x, cg_q);
+        for_cells([&](size_t x, size_t y) {
+            if (!in_p_system(x, y))
+                return;
+            cg_r[x][y] = cg_b[x][y] - cg_q[x][y];
+            cg_z[x][y] = cg_r[x][y] / double(dirs[x][y]);
+            cg_d[x][y] = cg_z[x][y];
+        });
+
+        double rhs = std::sqrt(dot_p(cg_b, cg_b));
+        double rz = dot_p(cg_r, cg_z);
+        for (int it = 0; it < implicit_max_iterations; ++it) {
+            if (std::sqrt(dot_p(cg_r, cg_r)) <= implicit_tolerance * rhs)
+                break;
+            apply_p_operator(cg_d, cg_q);
+            double dq = dot_p(cg_d, cg_q);
+            if (dq <= 0)
+                break;
+            double a = rz / dq;
+            for_cells([&](size_t x, size_t y) {
+                if (!in_p_system(x, y))
+                    return;
+                cg_x[x][y] += a * cg_d[x][y];
+                cg_r[x][y] -= a * cg_q[x][y];
+                cg_z[x][y] = cg_r[x][y] / double(dirs[x][y]);
+            });
+            double rz_new = dot_p(cg_r, cg_z);
+            double beta = rz_new / rz;
+            rz = rz_new;
+            for_cells([&](size_t x, size_t y) {
+                if (in_p_system(x, y))
+                    cg_d[x][y] = cg_z[x][y] + beta * cg_d[x][y];
+            });
         }
+
+        for_cells([&](size_t x, size_t y) {
+            if (!in_p_system(x, y))
+                return;
+            PType solved = cg_x[x][y];
+            total_delta_p += solved - p[x][y];
+            p[x][y] = solved;
+        });
     };
 
     void make_flow_from_velocities() {
+        TRACE_SCOPE("make_flow_from_velocities");
         velocity_flow.clear();
 
         bool prop = false;
         do {
+            TRACE_SCOPE("flow_sweep");
             UT += 2;
             prop = false;
-            for (size_t x = 0; x < N; ++x) {
-                for (size_t y = 0; y < K; ++y) {
-                    if (field[x][y] != '#' && last_use[x][y] != UT) {
-                        auto [t, local_prop, _] = propagate_flow(x, y, int64_t(1));
-                        if (t > int64_t(0)) {
-                            prop = true;
-                        }
+            for_cells([&](size_t x, size_t y) {
+                if (field[x][y] != '#' && last_use[x][y] != UT) {
+                    auto [t, local_prop, _] = propagate_flow(x, y, int64_t(1));
+                    if (t > int64_t(0)) {
+                        prop = true;
                     }
                 }
-            }
+            });
         } while (prop);
     };
 
     void recalculate_p(PType &total_delta_p) {
-        for (size_t x = 0; x < N; ++x) {
-            for (size_t y = 0; y < K; ++y) {
-                if (field[x][y] == '#')
-                    continue;
-                for (auto [dx, dy]: deltas) {
-                    VType old_v = velocity.get(x, y, dx, dy);
-                    VFType new_v = velocity_flow.get(x, y, dx, dy);
-                    if (old_v > int64_t(0)) {
-                        assert(VType(new_v) <= old_v);
-                        velocity.get(x, y, dx, dy) = VType(new_v);
-                        auto force = PType(old_v - VType(new_v)) * rho[(int) field[x][y]];
-                        if (field[x][y] == '.')
-                            force *= PType(0.8);
-                        if (field[x + dx][y + dy] == '#') {
-                            p[x][y] += force / PType(dirs[x][y]);
-                            total_delta_p += force / PType(dirs[x][y]);
-                        } else {
-                            p[x + dx][y + dy] += force / PType(dirs[x + dx][y + dy]);
-                            total_delta_p += force / PType(dirs[x + dx][y + dy]);
-                        }
+        TRACE_SCOPE("recalculate_p");
+        for_cells([&](size_t x, size_t y) {
+            if (field[x][y] == '#')
+                return;
+            for (auto [dx, dy]: deltas) {
+                VType old_v = velocity.get(x, y, dx, dy);
+                VFType new_v = velocity_flow.get(x, y, dx, dy);
+                if (old_v > int64_t(0)) {
+                    // floating point flows can overshoot the capacity by an ulp
+                    VType flow_v = std::min(VType(new_v), old_v);
+                    velocity.get(x, y, dx, dy) = flow_v;
+                    auto force = PType(old_v - flow_v) * rho[(int) field[x][y]];
+                    if (field[x][y] == '.')
+                        force *= PType(0.8);
+                    if (field[x + dx][y + dy] == '#') {
+                        p[x][y] += force / PType(dirs[x][y]);
+                        total_delta_p += force / PType(dirs[x][y]);
+                    } else {
+                        p[x + dx][y + dy] += force / PType(dirs[x + dx][y + dy]);
+                        total_delta_p += force / PType(dirs[x + dx][y + dy]);
                     }
                 }
             }
-        }
+        });
     };
 
     bool apply_move_on_flow() {
+        TRACE_SCOPE("apply_move_on_flow");
         UT += 2;
         bool prop = false;
-        for (size_t x = 0; x < N; ++x) {
-            for (size_t y = 0; y < K; ++y) {
-                if (field[x][y] != '#' && last_use[x][y] != UT) {
-                    if (random01<VType>() < move_prob(x, y)) {
-                        prop = true;
-                        propagate_move(x, y, true);
-                    } else {
-                        propagate_stop(x, y, true);
-                    }
+        for_cells([&](size_t x, size_t y) {
+            if (field[x][y] != '#' && last_use[x][y] != UT) {
+                if (random01<VType>(rnd) < move_prob(x, y)) {
+                    prop = true;
+                    propagate_move(x, y, true);
+                } else {
+                    propagate_stop(x, y, true);
                 }
             }
-        }
+        });
 
         return prop;
     };
 
     ~Field() override = default;
 
-    void save(const std::string& filename, size_t i) override {
-        std::ofstream file(filename);
-        if (!file.is_open()) {
-            throw std::runtime_error("Unable to open file: " + filename);
+    void exportState(std::string& cells, std::vector<double>& pressure) const override {
+        cells.resize(size_t(N) * K);
+        pressure.resize(size_t(N) * K);
+        for (int x = 0; x < N; x++) {
+            for (int y = 0; y < K; y++) {
+                cells[size_t(x) * K + y] = field[x][y];
+                pressure[size_t(x) * K + y] = field[x][y] == '#' ? 0.0 : double(p[x][y]);
+            }
         }
+    };
 
-        json config_json;
-        config_json["rhoField"] = double(rho[' ']);
-        config_json["rhoFluid"] = double(rho['.']);
-        config_json["g"] = double(g);
-        config_json["N"] = int(N);
-        config_json["K"] = int(K);
-        config_json["Tick"] = int(i);
-
-        std::vector<std::string> vec(N, std::string(K, ' '));
-        for (int y = 0; y < N; y++) {
-            for (int x = 0; x < K; x++) {
-                vec[y][x] = char(field[y][x]);
+    // Replaces an interior cell; the cell and the flows into it start from rest.
+    void setCell(int x, int y, char c) override {
+        if (x <= 0 || y <= 0 || x >= N - 1 || y >= K - 1) {
+            throw std::out_of_range("Cell outside the field interior: " + std::to_string(x) + " " + std::to_string(y));
+        }
+        if constexpr (N_val < 0) {
+            field.unseal(x, y);
+        }
+        field[x][y] = c;
+        velocity.v[x][y] = {};
+        p[x][y] = old_p[x][y] = PType{};
+
+        auto count_dirs = [&](int cx, int cy) {
+            int64_t d = 0;
+            if (field[cx][cy] != '#') {
+                for (auto [dx, dy] : deltas) {
+                    d += (field[cx + dx][cy + dy] != '#');
+                }
+            }
+            dirs[cx][cy] = d;
+        };
+        count_dirs(x, y);
+        for (auto [dx, dy] : deltas) {
+            velocity.get(x + dx, y + dy, -dx, -dy) = VType{};
+            count_dirs(x + dx, y + dy);
+        }
+    };
+
+    // Sparse storage only: sealed tiles of the grid and tiles actually allocated over all planes.
+    void reportStorage(std::ostream& out) const override {
+        if constexpr (N_val < 0) {
+            size_t tiles = 0, bytes = 0;
+            auto count = [&]<typename T>(const Array<T, N_val, K_val>& a) {
+                tiles += a.allocated();
+                bytes += a.allocated() * SPARSE_TILE * SPARSE_TILE * sizeof(T);
+            };
+            count(field); count(velocity.v); count(velocity_flow.v);
+            count(last_use); count(dirs); count(outgoing); count(p); count(old_p);
+            if (cg) {
+                count(cg->x); count(cg->b); count(cg->r); count(cg->z); count(cg->d); count(cg->q);
             }
+            out << "Storage: sparse " << SPARSE_TILE << "x" << SPARSE_TILE << " tiles for " << N << "x" << K << ", "
+                << field.solid() << " of " << size_t(field.TN) * field.TK << " tiles are solid, "
+                << tiles << " tiles allocated (" << bytes / 1024 << " KiB)\n";
         }
-        config_json["field"] = vec;
+    };
 
-        file << config_json.dump(4);
+    void save(const std::string& filename, size_t i) override {
+        TRACE_SCOPE("save", int64_t(i));
+        Snapshot local;
+        Snapshot* s = output ? output->acquire(OutputKind::SAVE) : &local;
+        fill_snapshot(*s, OutputKind::SAVE, i);
+        s->filename = filename;
+        s->rhoField = double(rho[' ']);
+        s->rhoFluid = double(rho['.']);
+        s->g = double(g);
+
+        if (output) {
+            output->publish();
+        } else {
+            writeSnapshot(local);
+        }
     };
 };
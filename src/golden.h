@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+#include "trial.h"
+
+// Allowed regressions against the stored baseline, relative to the recorded values.
+constexpr double golden_mismatch_ratio = 1.25;
+constexpr double golden_mismatch_slack = 1e-3;
+constexpr double golden_l2_ratio = 1.1;
+constexpr double golden_tps_ratio = 0.5;
+// Throughput is only gated with --golden-throughput, as the best of several runs:
+// a single wall-clock sample is too noisy, and stored numbers are machine-specific.
+constexpr int golden_tps_repeats = 3;
+
+TrialResult goldenTrial(genfunc make, const FieldConfig& info, const Parser& parser) {
+    return bestTrial(make, info, parser.golden_ticks, parser, parser.golden_throughput ? golden_tps_repeats : 1);
+}
+
+std::string hexDigest(uint64_t digest) {
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long) digest);
+    return buffer;
+}
+
+template <typename Types, typename Simulators>
+int runGolden(const Types& types, const Simulators& simulators, const FieldConfig& info, const Parser& parser) {
+    size_t ref_index = findSimulator(types, DOUBLE, DOUBLE, DOUBLE, info.h, info.w, parser.sparse);
+    if (ref_index == types.size()) {
+        std::cout << "Golden run needs DOUBLE in TYPES as the reference\n";
+        return EXIT_FAILURE;
+    }
+
+    nlohmann::json baselines = nlohmann::json::object();
+    {
+        std::ifstream in(parser.golden_filename);
+        if (in.is_open()) in >> baselines;
+    }
+    auto& baseline = baselines[std::to_string(sceneHash(parser.input_filename))];
+    auto& scene = baseline[trialMode(parser)];
+    bool record = parser.golden_update;
+    if (!record && scene.empty()) {
+        std::cout << "No baseline for " << parser.input_filename << " (" << trialMode(parser) << ") in "
+                  << parser.golden_filename << ", use --golden-update to record one\n";
+        return EXIT_FAILURE;
+    }
+    if (record) {
+        baseline["scene"] = parser.input_filename;
+    }
+    if (!record && scene.value("ticks", int64_t(0)) != parser.golden_ticks) {
+        std::cout << "Baseline for " << parser.input_filename << " (" << trialMode(parser) << ") was recorded with "
+                  << scene.value("ticks", int64_t(0)) << " ticks, use --golden-update to re-record\n";
+        return EXIT_FAILURE;
+    }
+
+    TrialResult ref = goldenTrial(simulators[ref_index], info, parser);
+    if (!ref.ok) {
+        std::cout << "Reference DOUBLE run failed\n";
+        return EXIT_FAILURE;
+    }
+
+    // The other combinations are only compared with DOUBLE, so a change of the simulation
+    // itself is caught by the exact digest of the DOUBLE run.
+    std::string digest = hexDigest(stateDigest(ref));
+    bool failed = false;
+    if (record) {
+        scene["digest"] = digest;
+    } else if (scene.value("digest", "") != digest) {
+        std::cout << "FAILED: DOUBLE reference changed, digest " << digest << " instead of "
+                  << scene.value("digest", "") << "\n";
+        failed = true;
+    }
+
+    scene["ticks"] = parser.golden_ticks;
+    printf("%-16s %-16s %-16s %9s %12s %10s  %s\n", "P", "V", "VF", "mismatch", "pressure_l2", "ticks/s", "status");
+    for (int p: t) {
+        for (int v: t) {
+            for (int vf: t) {
+                size_t index = findSimulator(types, p, v, vf, info.h, info.w, parser.sparse);
+                if (index == types.size()) continue;
+
+                std::string name = getNameFromType(p) + "," + getNameFromType(v) + "," + getNameFromType(vf);
+                TrialResult r = index == ref_index ? ref : goldenTrial(simulators[index], info, parser);
+
+                std::string status = "ok";
+                Accuracy acc;
+                if (!r.ok) {
+                    status = "FAILED: run aborted";
+                } else {
+                    acc = compareTrial(ref, r, info);
+                }
+
+                auto& entry = scene["results"][name];
+                if (record) {
+                    if (r.ok) {
+                        entry = {{"mismatch", acc.mismatch}, {"pressure_l2", acc.pressure_l2},
+                                 {"ticks_per_sec", r.ticks_per_sec}};
+                    }
+                    status = r.ok ? "recorded" : status;
+                } else if (r.ok && !entry.is_null()) {
+                    if (acc.mismatch > entry.value("mismatch", 0.0) * golden_mismatch_ratio + golden_mismatch_slack) {
+                        status = "FAILED: mismatch";
+                    } else if (acc.pressure_l2 > entry.value("pressure_l2", 0.0) * golden_l2_ratio + 1e-9) {
+                        status = "FAILED: pressure";
+                    } else if (parser.golden_throughput &&
+                               r.ticks_per_sec < entry.value("ticks_per_sec", 0.0) * golden_tps_ratio) {
+                        status = "FAILED: throughput";
+                    }
+                } else if (r.ok) {
+                    status = "no baseline";
+                }
+                failed |= status.starts_with("FAILED");
+
+                printf("%-16s %-16s %-16s %9.4f %12.4g %10.1f  %s\n",
+                       getNameFromType(p).c_str(), getNameFromType(v).c_str(), getNameFromType(vf).c_str(),
+                       acc.mismatch, acc.pressure_l2, r.ticks_per_sec, status.c_str());
+            }
+        }
+    }
+
+    if (record) {
+        std::ofstream out(parser.golden_filename);
+        if (!out.is_open()) {
+            throw std::runtime_error("Unable to open file: " + parser.golden_filename);
+        }
+        out << baselines.dump(4);
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
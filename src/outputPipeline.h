@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+#include "trace.h"
+
+enum class OutputKind { TICK, DUMP, SAVE };
+enum class OutputPolicy { BLOCK, DROP };
+
+struct Snapshot {
+    OutputKind kind{};
+    size_t tick{};
+    int N = 0, K = 0;
+    double g{}, rhoField{}, rhoFluid{};
+    std::string header;
+    std::string filename;
+    std::string cells;
+};
+
+template <typename T, size_t Cap>
+struct SpscRing {
+    static_assert((Cap & (Cap - 1)) == 0, "ring capacity must be a power of two");
+
+    std::array<T, Cap> slots{};
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+
+    T* claim() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Cap) return nullptr;
+        return &slots[t & (Cap - 1)];
+    }
+
+    void publish() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    T* front() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return nullptr;
+        return &slots[h & (Cap - 1)];
+    }
+
+    void pop() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+};
+
+void writeSnapshot(const Snapshot& s) {
+    switch (s.kind) {
+        case OutputKind::TICK: {
+            TRACE_SCOPE("write_tick", int64_t(s.tick));
+            std::string out = "Tick " + std::to_string(s.tick) + ":\n";
+            out.reserve(out.size() + s.cells.size() + s.N);
+            for (int x = 0; x < s.N; x++) {
+                out.append(s.cells, x * s.K, s.K);
+                out += '\n';
+            }
+            std::cout.write(out.data(), out.size());
+            std::cout.flush();
+            break;
+        }
+        case OutputKind::DUMP: {
+            TRACE_SCOPE("write_dump", int64_t(s.tick));
+            std::ofstream out(s.filename);
+            out << s.header;
+            for (int x = 0; x < s.N; x++) {
+                out.write(s.cells.data() + x * s.K, s.K);
+                out << "\n";
+            }
+            break;
+        }
+        case OutputKind::SAVE: {
+            TRACE_SCOPE("write_save", int64_t(s.tick));
+            std::ofstream file(s.filename);
+            if (!file.is_open()) {
+                throw std::runtime_error("Unable to open file: " + s.filename);
+            }
+
+            nlohmann::json config_json;
+            config_json["rhoField"] = s.rhoField;
+            config_json["rhoFluid"] = s.rhoFluid;
+            config_json["g"] = s.g;
+            config_json["N"] = s.N;
+            config_json["K"] = s.K;
+            config_json["Tick"] = int(s.tick);
+
+            std::vector<std::string> vec(s.N);
+            for (int x = 0; x < s.N; x++) {
+                vec[x] = s.cells.substr(x * s.K, s.K);
+            }
+            config_json["field"] = vec;
+
+            file << config_json.dump(4);
+            break;
+        }
+    }
+}
+
+// Hands snapshots from the compute thread to a single writer thread. Console
+// frames may be dropped under OutputPolicy::DROP, file outputs always wait.
+struct OutputPipeline {
+    static constexpr size_t capacity = 64;
+
+    OutputPolicy policy;
+    SpscRing<Snapshot, capacity> ring;
+    std::atomic<bool> running{true};
+    size_t dropped = 0, stalls = 0;
+    std::thread worker;
+
+    explicit OutputPipeline(OutputPolicy policy = OutputPolicy::BLOCK): policy(policy), worker([this] { consume(); }) {}
+
+    OutputPipeline(const OutputPipeline&) = delete;
+    OutputPipeline& operator=(const OutputPipeline&) = delete;
+
+    ~OutputPipeline() {
+        running.store(false, std::memory_order_release);
+        worker.join();
+    }
+
+    Snapshot* acquire(OutputKind kind) {
+        Snapshot* s = ring.claim();
+        if (s) return s;
+        if (policy == OutputPolicy::DROP && kind == OutputKind::TICK) {
+            ++dropped;
+            return nullptr;
+        }
+        ++stalls;
+        TRACE_SCOPE("output_stall");
+        while (!(s = ring.claim())) {
+            std::this_thread::yield();
+        }
+        return s;
+    }
+
+    void publish() {
+        ring.publish();
+    }
+
+    void flush() {
+        while (!ring.empty()) {
+            std::this_thread::yield();
+        }
+    }
+
+    void consume() {
+        tracer.nameThread("output");
+        while (true) {
+            Snapshot* s = ring.front();
+            if (!s) {
+                if (!running.load(std::memory_order_acquire) && ring.empty()) break;
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                continue;
+            }
+            try {
+                writeSnapshot(*s);
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << "\n";
+            }
+            ring.pop();
+        }
+    }
+};
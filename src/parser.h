@@ -10,6 +10,7 @@
 #define S(a, b) pair<int, int>(a, b)
 
 #define DYNAMIC pair{0, 0}
+#define SPARSE pair{-1, -1}
 
 #define DOUBLE_T "DOUBLE"
 #define FLOAT_T  "FLOAT"
@@ -55,10 +56,30 @@ int getTypeFromName(std::string& name) {
     return FAST_FIXED(stoi(numbers[0]), stoi(numbers[1]));
 }
 
+std::string getNameFromType(int type) {
+    if (type == FLOAT)  {return FLOAT_T;}
+    if (type == DOUBLE) {return DOUBLE_T;}
+    if (type >= 10000)  {return "FAST_FIXED(" + std::to_string(type / 10000) + "," + std::to_string(type % 10000) + ")";}
+    return "FIXED(" + std::to_string(type / 100) + "," + std::to_string(type % 100) + ")";
+}
+
 struct Parser {
     int p_type = 0, v_type = 0, vf_type = 0;
-    std::string input_filename, output_filename;
+    std::string input_filename, output_filename, trace_filename;
+    std::string golden_filename;
+    std::string serve_path;
+    int64_t golden_ticks = 200;
+    bool golden_update = false;
+    bool golden_throughput = false;
+    bool auto_types = false;
+    bool implicit_pressure = false;
+    bool sparse = false;
+    int64_t tune_ticks = 100;
+    std::string tune_cache_filename = "types_cache.json";
     int64_t n_ticks;
+    bool drop_frames = false;
+    bool huge_pages = false;
+    bool pin_threads = false;
 
     void parseArgs(const int argc, char* argv[]) {
         std::string all;
@@ -66,7 +87,9 @@ struct Parser {
             all += argv[i]; all += " ";
         }
 
-        std::string p_type_s, v_type_s, vf_type_s, in_filename, out_filename, ticks;
+        std::string p_type_s, v_type_s, vf_type_s, in_filename, out_filename, ticks, policy, trace, golden, golden_ticks_s, golden_update_s,
+                    auto_types_s, tune_ticks_s, tune_cache, pressure, storage,
+                    huge_pages_s, pin_threads_s, serve, golden_tps_s;
         int group = 1;
 
         parseAndExtract("--p-type="   STRING_TYPES,     &p_type_s,    all, &group, 1);
@@ -74,11 +97,39 @@ struct Parser {
         parseAndExtract("--vf-type="  STRING_TYPES,     &vf_type_s,   all, &group, 1);
         parseAndExtract("--in-file="  STRING_FILE_PATH, &in_filename, all, &group, 1);
         parseAndExtract("--out-file=" STRING_FILE_PATH, &out_filename,all, &group, 1);
+        parseAndExtract("--output-policy=(block|drop)", &policy, all, &group, 1);
+        parseAndExtract("--trace="    STRING_FILE_PATH, &trace,       all, &group, 1);
+        parseAndExtract("--golden-ticks=([0-9]+)", &golden_ticks_s,   all, &group, 1);
+        parseAndExtract("(--golden-update)",       &golden_update_s,  all, &group, 1);
+        parseAndExtract("(--golden-throughput)",   &golden_tps_s,     all, &group, 1);
+        parseAndExtract("--golden="   STRING_FILE_PATH, &golden,      all, &group, 1);
+        parseAndExtract("--pressure=(explicit|implicit)", &pressure, all, &group, 1);
+        parseAndExtract("--storage=(dense|sparse)",        &storage,  all, &group, 1);
+        parseAndExtract("(--auto-types)",          &auto_types_s,     all, &group, 1);
+        parseAndExtract("--tune-ticks=([0-9]+)",   &tune_ticks_s,     all, &group, 1);
+        parseAndExtract("--tune-cache=" STRING_FILE_PATH, &tune_cache, all, &group, 1);
+        parseAndExtract("(--huge-pages)",          &huge_pages_s,     all, &group, 1);
+        parseAndExtract("(--pin-threads)",         &pin_threads_s,    all, &group, 1);
+        parseAndExtract("--serve="    STRING_FILE_PATH, &serve,       all, &group, 1);
         p_type  = getTypeFromName(p_type_s);
         v_type  = getTypeFromName(v_type_s);
         vf_type = getTypeFromName(vf_type_s);
         input_filename =  in_filename;
         output_filename = out_filename;
+        trace_filename = trace;
+        golden_filename = golden;
+        serve_path = serve;
+        if (!golden_ticks_s.empty()) golden_ticks = stoi(golden_ticks_s);
+        golden_update = !golden_update_s.empty();
+        golden_throughput = !golden_tps_s.empty();
+        auto_types = !auto_types_s.empty();
+        implicit_pressure = (pressure == "implicit");
+        sparse = (storage == "sparse");
+        if (!tune_ticks_s.empty()) tune_ticks = stoi(tune_ticks_s);
+        if (!tune_cache.empty()) tune_cache_filename = tune_cache;
         if (!ticks.empty()) n_ticks = stoi(ticks);
+        drop_frames = (policy == "drop");
+        huge_pages = !huge_pages_s.empty();
+        pin_threads = !pin_threads_s.empty();
     }
 };
\ No newline at end of file
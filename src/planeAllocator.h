@@ -0,0 +1,143 @@
+#pragma once
+
+#include <new>
+#include <thread>
+#include <string>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <unistd.h>
+
+constexpr size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+constexpr size_t PLANE_ALIGNMENT = 64;
+
+// Must be configured before the first plane is allocated.
+struct PlaneMemory {
+    bool huge_pages = false;
+    bool pin_threads = false;
+
+    size_t planes = 0, bytes = 0, explicit_huge = 0, transparent_huge = 0;
+};
+
+PlaneMemory planeMemory;
+
+void pinThread(int cpu, pthread_t thread = pthread_self()) {
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % cpus, &set);
+    pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+void* allocatePlane(size_t bytes) {
+    planeMemory.planes++;
+    if (!planeMemory.huge_pages) {
+        void* ptr = ::operator new(bytes, std::align_val_t(PLANE_ALIGNMENT));
+        planeMemory.bytes += bytes;
+        return ptr;
+    }
+
+    size_t size = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED) {
+        planeMemory.explicit_huge += size;
+    } else {
+        ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) throw std::bad_alloc();
+        if (madvise(ptr, size, MADV_HUGEPAGE) == 0) planeMemory.transparent_huge += size;
+    }
+    planeMemory.bytes += size;
+    // Phases run on the compute thread only, so it is the one to fault the pages in.
+    std::memset(ptr, 0, size);
+    return ptr;
+}
+
+void freePlane(void* ptr, size_t bytes) {
+    if (!ptr) return;
+    if (!planeMemory.huge_pages) {
+        ::operator delete(ptr, std::align_val_t(PLANE_ALIGNMENT));
+        return;
+    }
+    munmap(ptr, (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+}
+
+template <typename T>
+struct PlaneAllocator {
+    using value_type = T;
+
+    PlaneAllocator() = default;
+    template <typename U>
+    PlaneAllocator(const PlaneAllocator<U>&) {}
+
+    T* allocate(size_t n) {return static_cast<T*>(allocatePlane(n * sizeof(T)));}
+    void deallocate(T* ptr, size_t n) {freePlane(ptr, n * sizeof(T));}
+
+    bool operator==(const PlaneAllocator&) const {return true;}
+};
+
+// Counts data TLB load misses of the calling thread, if the kernel allows it.
+struct TlbCounter {
+    int fd = -1;
+
+    void start() {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    int64_t stop() {
+        if (fd < 0) return -1;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        int64_t count = -1;
+        if (read(fd, &count, sizeof(count)) != sizeof(count)) count = -1;
+        close(fd);
+        fd = -1;
+        return count;
+    }
+};
+
+size_t anonHugePagesKb() {
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    std::string key;
+    size_t kb = 0;
+    while (smaps >> key) {
+        if (key == "AnonHugePages:") {
+            smaps >> kb;
+            break;
+        }
+        smaps.ignore(256, '\n');
+    }
+    return kb;
+}
+
+void reportPlaneMemory(std::ostream& out, int64_t tlb_misses, size_t ticks, double seconds) {
+    out << "Planes: " << planeMemory.planes << " allocations, " << planeMemory.bytes / 1024 << " KiB";
+    if (planeMemory.huge_pages) {
+        out << ", explicit huge pages " << planeMemory.explicit_huge / 1024 << " KiB"
+            << ", transparent requested " << planeMemory.transparent_huge / 1024 << " KiB";
+    }
+    out << ", AnonHugePages " << anonHugePagesKb() << " KiB\n";
+    out << "Ticks: " << ticks << " in " << seconds << " s (" << (seconds > 0 ? ticks / seconds : 0) << " ticks/s)";
+    if (tlb_misses >= 0) {
+        out << ", dTLB load misses " << tlb_misses << " (" << (ticks ? tlb_misses / int64_t(ticks) : 0) << "/tick)";
+    } else {
+        out << ", dTLB load misses n/a";
+    }
+    out << "\n";
+}
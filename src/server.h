@@ -0,0 +1,385 @@
+#pragma once
+
+#include <map>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <charconv>
+#include <iostream>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+#include "field.h"
+#include "parser.h"
+#include "typesAndField.h"
+
+// Requests are text lines, every response is one frame: FrameHeader followed by `length` payload bytes.
+//   load <id> <scene.json> [<P> <V> <VF>] [implicit] [sparse]
+//   run <id> <ticks> [<every>]     every > 0 streams a FRAME_PART state frame each `every` ticks
+//   edit <id> <x> <y> <c> ...      c is '#', '.' or '_' for air
+//   fetch <id>                     state: uint32 N, uint32 K, N*K cells, N*K double pressures
+//   drop <id>
+constexpr uint32_t FRAME_MAGIC = 0x56534c46;
+// A client whose pending line grows past this gets an error frame and is disconnected.
+constexpr size_t MAX_REQUEST_LINE = 1 << 16;
+
+enum FrameStatus: uint32_t { FRAME_OK = 0, FRAME_ERROR = 1, FRAME_PART = 2 };
+
+struct FrameHeader {
+    uint32_t magic = FRAME_MAGIC;
+    uint32_t status = FRAME_OK;
+    uint64_t tick = 0;
+    uint32_t latency_us = 0;
+    uint32_t length = 0;
+};
+static_assert(sizeof(FrameHeader) == 24);
+
+struct Scene {
+    std::unique_ptr<AbstractField> field;
+    size_t tick = 0;
+    uint32_t N = 0, K = 0;
+    std::string cells;
+    std::vector<double> pressure;
+};
+
+struct CachedConfig {
+    timespec mtime{};
+    std::unique_ptr<FieldConfig> config;
+};
+
+struct CellEdit {
+    int x = 0, y = 0;
+    char c = ' ';
+};
+
+struct ServerClient {
+    int fd = -1;
+    std::string in;
+};
+
+// Percentiles come from a uniform reservoir of at most `capacity` samples, count and max are exact.
+struct LatencyStats {
+    static constexpr size_t capacity = 4096;
+    std::vector<uint32_t> samples;
+    size_t count = 0;
+    uint32_t max = 0;
+    std::minstd_rand rnd;
+
+    void add(uint32_t us) {
+        max = std::max(max, us);
+        if (samples.size() < capacity) {
+            samples.push_back(us);
+        } else if (size_t j = rnd() % (count + 1); j < capacity) {
+            samples[j] = us;
+        }
+        count++;
+    }
+
+    void print(const std::string& name) const {
+        if (samples.empty()) return;
+        std::vector<uint32_t> s = samples;
+        std::sort(s.begin(), s.end());
+        std::cout << name << ": " << count << " requests, p50 " << s[s.size() / 2] << " us, p99 "
+                  << s[std::min(s.size() - 1, s.size() * 99 / 100)] << " us, max " << max << " us\n";
+    }
+};
+
+bool sendAll(int fd, const void* data, size_t size) {
+    auto ptr = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = send(fd, ptr, size, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        ptr += n; size -= n;
+    }
+    return true;
+}
+
+template <typename T>
+bool parseNumber(std::string_view s, T& value) {
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+    return ec == std::errc() && end == s.data() + s.size();
+}
+
+// Keeps loaded fields warm between requests. Single-threaded: connections are
+// multiplexed with poll and requests run to completion in arrival order.
+template <typename Types, typename Simulators>
+struct Server {
+    const Types& types;
+    const Simulators& simulators;
+    const Parser& defaults;
+
+    std::unordered_map<std::string, Scene> scenes;
+    std::unordered_map<std::string, CachedConfig> configs;
+    std::unordered_map<std::string, int> type_names;
+    std::map<std::string, LatencyStats, std::less<>> latency;
+
+    std::vector<std::string_view> args;
+    std::vector<CellEdit> edits;
+    std::string frame;
+    std::chrono::steady_clock::time_point started;
+
+    Server(const Types& types, const Simulators& simulators, const Parser& defaults):
+        types(types), simulators(simulators), defaults(defaults) {}
+
+    uint32_t elapsedUs() const {
+        return uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - started).count());
+    }
+
+    bool reply(int fd, uint32_t status, uint64_t tick, std::string_view payload = {}) {
+        FrameHeader h;
+        h.status = status; h.tick = tick;
+        h.length = uint32_t(payload.size());
+        h.latency_us = elapsedUs();
+        frame.assign(reinterpret_cast<const char*>(&h), sizeof(h));
+        frame.append(payload);
+        return sendAll(fd, frame.data(), frame.size());
+    }
+
+    bool replyState(int fd, Scene& s, uint32_t status) {
+        s.field->exportState(s.cells, s.pressure);
+        FrameHeader h;
+        h.status = status; h.tick = s.tick;
+        h.length = uint32_t(2 * sizeof(uint32_t) + s.cells.size() + s.pressure.size() * sizeof(double));
+        h.latency_us = elapsedUs();
+        frame.assign(reinterpret_cast<const char*>(&h), sizeof(h));
+        frame.append(reinterpret_cast<const char*>(&s.N), sizeof(s.N));
+        frame.append(reinterpret_cast<const char*>(&s.K), sizeof(s.K));
+        frame.append(s.cells);
+        frame.append(reinterpret_cast<const char*>(s.pressure.data()), s.pressure.size() * sizeof(double));
+        return sendAll(fd, frame.data(), frame.size());
+    }
+
+    // Type names are resolved once, so the regex behind getTypeFromName stays off the request path.
+    int typeFromName(std::string_view name) {
+        std::string key(name);
+        auto it = type_names.find(key);
+        if (it != type_names.end()) return it->second;
+        std::string s = key;
+        return type_names[key] = getTypeFromName(s);
+    }
+
+    // Parsed scenes are reused until the file changes on disk.
+    const FieldConfig& config(const std::string& filename) {
+        struct stat st{};
+        if (stat(filename.c_str(), &st) != 0) {
+            throw std::runtime_error("Unable to open file: " + filename);
+        }
+        auto& cached = configs[filename];
+        if (!cached.config || cached.mtime.tv_sec != st.st_mtim.tv_sec || cached.mtime.tv_nsec != st.st_mtim.tv_nsec) {
+            cached.config = std::make_unique<FieldConfig>(filename);
+            cached.mtime = st.st_mtim;
+        }
+        return *cached.config;
+    }
+
+    Scene& scene(std::string_view id) {
+        auto it = scenes.find(std::string(id));
+        if (it == scenes.end()) {
+            throw std::runtime_error("Unknown scene: " + std::string(id));
+        }
+        return it->second;
+    }
+
+    void load(int fd) {
+        if (args.size() < 3) throw std::runtime_error("Usage: load <id> <scene.json> [<P> <V> <VF>] [implicit] [sparse]");
+        const FieldConfig& info = config(std::string(args[2]));
+
+        Parser parser{};
+        parser.p_type = defaults.p_type; parser.v_type = defaults.v_type; parser.vf_type = defaults.vf_type;
+        parser.implicit_pressure = defaults.implicit_pressure;
+        parser.sparse = defaults.sparse;
+        size_t i = 3;
+        if (args.size() >= 6 && args[3] != "implicit" && args[3] != "sparse") {
+            parser.p_type = typeFromName(args[3]);
+            parser.v_type = typeFromName(args[4]);
+            parser.vf_type = typeFromName(args[5]);
+            i = 6;
+        }
+        for (; i < args.size(); i++) {
+            if (args[i] == "implicit") parser.implicit_pressure = true;
+            else if (args[i] == "sparse") parser.sparse = true;
+            else throw std::runtime_error("Unknown load option: " + std::string(args[i]));
+        }
+
+        size_t index = findSimulator(types, parser.p_type, parser.v_type, parser.vf_type, info.h, info.w, parser.sparse);
+        if (index == types.size()) {
+            throw std::runtime_error("Simulator with chosen types does not exist");
+        }
+
+        Scene s;
+        s.field = simulators[index]();
+        s.field->init(info, parser);
+        s.tick = info.tick;
+        s.N = uint32_t(info.h); s.K = uint32_t(info.w);
+        uint64_t tick = s.tick;
+        scenes[std::string(args[1])] = std::move(s);
+        reply(fd, FRAME_OK, tick);
+    }
+
+    void runTicks(int fd) {
+        size_t ticks = 0, every = 0;
+        if (args.size() < 3 || !parseNumber(args[2], ticks) || (args.size() > 3 && !parseNumber(args[3], every))) {
+            throw std::runtime_error("Usage: run <id> <ticks> [<every>]");
+        }
+        Scene& s = scene(args[1]);
+        for (size_t i = 0; i < ticks; i++) {
+            s.field->nextTick(int(s.tick++));
+            if (every && (i + 1) % every == 0 && i + 1 < ticks) {
+                if (!replyState(fd, s, FRAME_PART)) return;
+            }
+        }
+        if (every) {
+            replyState(fd, s, FRAME_OK);
+        } else {
+            reply(fd, FRAME_OK, s.tick);
+        }
+    }
+
+    // All triples are checked before any is applied, so a rejected request leaves the scene untouched.
+    void edit(int fd) {
+        if (args.size() < 5 || (args.size() - 2) % 3 != 0) {
+            throw std::runtime_error("Usage: edit <id> <x> <y> <c> ...");
+        }
+        Scene& s = scene(args[1]);
+        edits.clear();
+        for (size_t i = 2; i < args.size(); i += 3) {
+            CellEdit e;
+            if (!parseNumber(args[i], e.x) || !parseNumber(args[i + 1], e.y) || args[i + 2].size() != 1) {
+                throw std::runtime_error("Bad edit: " + std::string(args[i]) + " " + std::string(args[i + 1]) + " " +
+                                         std::string(args[i + 2]));
+            }
+            if (e.x <= 0 || e.y <= 0 || e.x >= int(s.N) - 1 || e.y >= int(s.K) - 1) {
+                throw std::runtime_error("Cell outside the field interior: " + std::to_string(e.x) + " " +
+                                         std::to_string(e.y));
+            }
+            e.c = args[i + 2][0] == '_' ? ' ' : args[i + 2][0];
+            if (e.c != '#' && e.c != '.' && e.c != ' ') {
+                throw std::runtime_error("Bad cell: " + std::string(args[i + 2]));
+            }
+            edits.push_back(e);
+        }
+        for (auto& e: edits) {
+            s.field->setCell(e.x, e.y, e.c);
+        }
+        reply(fd, FRAME_OK, s.tick);
+    }
+
+    bool handle(int fd, std::string_view line) {
+        started = std::chrono::steady_clock::now();
+        args.clear();
+        for (size_t i = 0; i < line.size();) {
+            size_t end = line.find_first_of(" \t\r", i);
+            if (end == std::string_view::npos) end = line.size();
+            if (end > i) args.push_back(line.substr(i, end - i));
+            i = end + 1;
+        }
+        if (args.empty()) return true;
+
+        try {
+            std::string_view cmd = args[0];
+            if (cmd == "load") {
+                load(fd);
+            } else if (cmd == "run") {
+                runTicks(fd);
+            } else if (cmd == "edit") {
+                edit(fd);
+            } else if (cmd == "fetch" && args.size() == 2) {
+                replyState(fd, scene(args[1]), FRAME_OK);
+            } else if (cmd == "drop" && args.size() == 2) {
+                scenes.erase(std::string(args[1]));
+                reply(fd, FRAME_OK, 0);
+            } else {
+                throw std::runtime_error("Unknown request: " + std::string(line));
+            }
+        } catch (const std::exception& e) {
+            return reply(fd, FRAME_ERROR, 0, e.what());
+        }
+
+        auto it = latency.find(args[0]);
+        if (it == latency.end()) it = latency.emplace(std::string(args[0]), LatencyStats{}).first;
+        it->second.add(elapsedUs());
+        return true;
+    }
+
+    int run(const std::string& path, const bool& stop) {
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (listener < 0 || path.size() >= sizeof(addr.sun_path)) {
+            throw std::runtime_error("Unable to create socket: " + path);
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        unlink(path.c_str());
+        if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 16) != 0) {
+            close(listener);
+            throw std::runtime_error("Unable to listen on " + path);
+        }
+        std::cout << "Serving on " << path << std::endl;
+
+        std::vector<ServerClient> clients;
+        std::vector<pollfd> fds;
+        char buffer[1 << 16];
+        while (!stop) {
+            fds.assign(1, pollfd{listener, POLLIN, 0});
+            for (auto& c: clients) {
+                fds.push_back(pollfd{c.fd, POLLIN, 0});
+            }
+            if (poll(fds.data(), fds.size(), -1) < 0) continue;
+
+            for (size_t i = 1; i < fds.size(); i++) {
+                if (!fds[i].revents) continue;
+                ServerClient& c = clients[i - 1];
+                ssize_t n = read(c.fd, buffer, sizeof(buffer));
+                bool alive = n > 0;
+                if (alive) {
+                    c.in.append(buffer, n);
+                    size_t begin = 0, end;
+                    while (alive && (end = c.in.find('\n', begin)) != std::string::npos) {
+                        alive = handle(c.fd, std::string_view(c.in).substr(begin, end - begin));
+                        begin = end + 1;
+                    }
+                    c.in.erase(0, begin);
+                    if (alive && c.in.size() > MAX_REQUEST_LINE) {
+                        started = std::chrono::steady_clock::now();
+                        reply(c.fd, FRAME_ERROR, 0, "Request line longer than " + std::to_string(MAX_REQUEST_LINE) + " bytes");
+                        alive = false;
+                    }
+                }
+                if (!alive) {
+                    close(c.fd);
+                    c.fd = -1;
+                }
+            }
+            std::erase_if(clients, [](const ServerClient& c) {return c.fd < 0;});
+
+            if (fds[0].revents & POLLIN) {
+                int fd = accept(listener, nullptr, nullptr);
+                if (fd >= 0) clients.push_back(ServerClient{fd, {}});
+            }
+        }
+
+        for (auto& c: clients) {
+            close(c.fd);
+        }
+        close(listener);
+        unlink(path.c_str());
+
+        for (auto& [name, stats]: latency) {
+            stats.print(name);
+        }
+        return EXIT_SUCCESS;
+    }
+};
+
+template <typename Types, typename Simulators>
+int runServer(const Types& types, const Simulators& simulators, const Parser& parser, const bool& stop) {
+    return Server<Types, Simulators>(types, simulators, parser).run(parser.serve_path, stop);
+}
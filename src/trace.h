@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <fstream>
+
+struct TraceEvent {
+    const char* name;
+    int64_t start, dur;
+    int64_t arg;
+};
+
+// Preallocated per-thread ring: once full, the oldest events are overwritten.
+struct TraceBuffer {
+    static constexpr size_t capacity = 1 << 18;
+
+    std::unique_ptr<TraceEvent[]> events{new TraceEvent[capacity]};
+    size_t count = 0;
+    int tid = 0;
+    std::string name;
+
+    void push(const TraceEvent& e) {
+        events[count & (capacity - 1)] = e;
+        ++count;
+    }
+};
+
+struct Tracer {
+    std::atomic<bool> enabled{false};
+    std::string filename;
+    std::chrono::steady_clock::time_point origin;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+
+    void start(const std::string& file) {
+        filename = file;
+        origin = std::chrono::steady_clock::now();
+        enabled.store(true, std::memory_order_release);
+    }
+
+    int64_t now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    TraceBuffer& local() {
+        thread_local TraceBuffer* buffer = nullptr;
+        if (!buffer) {
+            std::lock_guard lock(mutex);
+            buffers.push_back(std::make_unique<TraceBuffer>());
+            buffer = buffers.back().get();
+            buffer->tid = int(buffers.size());
+            buffer->name = "thread " + std::to_string(buffer->tid);
+        }
+        return *buffer;
+    }
+
+    void nameThread(const std::string& name) {
+        if (enabled.load(std::memory_order_relaxed)) {
+            local().name = name;
+        }
+    }
+
+    // Must only be called once the traced threads are joined or idle.
+    void write() {
+        if (!enabled.exchange(false)) return;
+
+        std::ofstream out(filename);
+        if (!out.is_open()) {
+            throw std::runtime_error("Unable to open file: " + filename);
+        }
+
+        std::lock_guard lock(mutex);
+        out << "{\"traceEvents\":[\n";
+        bool first = true;
+        for (auto& b: buffers) {
+            if (!first) out << ",\n";
+            first = false;
+            out << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << b->tid
+                << R"(,"args":{"name":")" << b->name << "\"}}";
+
+            size_t begin = b->count > TraceBuffer::capacity ? b->count - TraceBuffer::capacity : 0;
+            for (size_t i = begin; i < b->count; i++) {
+                const TraceEvent& e = b->events[i & (TraceBuffer::capacity - 1)];
+                out << ",\n" << R"({"name":")" << e.name << R"(","ph":"X","pid":1,"tid":)" << b->tid
+                    << ",\"ts\":" << e.start / 1000 << "." << e.start % 1000 / 100
+                    << ",\"dur\":" << e.dur / 1000 << "." << e.dur % 1000 / 100;
+                if (e.arg >= 0) {
+                    out << R"(,"args":{"value":)" << e.arg << "}";
+                }
+                out << "}";
+            }
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+};
+
+Tracer tracer;
+
+struct TraceScope {
+    const char* name;
+    int64_t start, arg;
+
+    explicit TraceScope(const char* name, int64_t arg = -1):
+        name(name), start(tracer.enabled.load(std::memory_order_relaxed) ? tracer.now() : -1), arg(arg) {}
+
+    ~TraceScope() {
+        if (start >= 0) {
+            tracer.local().push({name, start, tracer.now() - start, arg});
+        }
+    }
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "field.h"
+#include "parser.h"
+#include "typesAndField.h"
+
+struct TrialResult {
+    bool ok = false;
+    double ticks_per_sec = 0;
+    std::string cells;
+    std::vector<double> pressure;
+};
+
+struct Accuracy {
+    double mismatch = 0;
+    double pressure_l2 = 0;
+};
+
+bool writeAll(int fd, const void* data, size_t size) {
+    auto ptr = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = write(fd, ptr, size);
+        if (n <= 0) return false;
+        ptr += n; size -= n;
+    }
+    return true;
+}
+
+bool readAll(int fd, void* data, size_t size) {
+    auto ptr = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = read(fd, ptr, size);
+        if (n <= 0) return false;
+        ptr += n; size -= n;
+    }
+    return true;
+}
+
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash = FNV_OFFSET) {
+    auto ptr = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ ptr[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// FNV-1a over the scene file, so results are keyed by content rather than by path.
+uint64_t sceneHash(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    std::string content{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    return fnv1a(content.data(), content.size());
+}
+
+// Exact digest of the final cells and pressures, for detecting any change of a run.
+uint64_t stateDigest(const TrialResult& r) {
+    return fnv1a(r.pressure.data(), r.pressure.size() * sizeof(double), fnv1a(r.cells.data(), r.cells.size()));
+}
+
+// Solver options that change what a trial measures, part of the golden and tuning keys.
+std::string trialMode(const Parser& options) {
+    return std::string(options.implicit_pressure ? "implicit" : "explicit") + "," + (options.sparse ? "sparse" : "dense");
+}
+
+// Runs `ticks` silent ticks with the fixed seed in a forked child, so a combination
+// that aborts (e.g. on an assert) only fails its own trial.
+TrialResult runTrial(genfunc make, const FieldConfig& info, size_t ticks, const Parser& options) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        throw std::runtime_error("Unable to create pipe for trial");
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw std::runtime_error("Unable to fork trial");
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        try {
+            Parser parser{};
+            parser.implicit_pressure = options.implicit_pressure;
+            parser.sparse = options.sparse;
+            auto field = make();
+            field->init(info, parser);
+
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < ticks; i++) {
+                field->nextTick(info.tick + i);
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            TrialResult r;
+            field->exportState(r.cells, r.pressure);
+            r.ticks_per_sec = ticks / std::max(elapsed.count(), 1e-9);
+
+            size_t n = r.cells.size();
+            bool ok = writeAll(fds[1], &r.ticks_per_sec, sizeof(r.ticks_per_sec)) &&
+                      writeAll(fds[1], &n, sizeof(n)) &&
+                      writeAll(fds[1], r.cells.data(), n) &&
+                      writeAll(fds[1], r.pressure.data(), n * sizeof(double));
+            _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+        } catch (...) {
+            _exit(EXIT_FAILURE);
+        }
+    }
+
+    close(fds[1]);
+    TrialResult r;
+    size_t n = 0;
+    bool ok = readAll(fds[0], &r.ticks_per_sec, sizeof(r.ticks_per_sec)) && readAll(fds[0], &n, sizeof(n));
+    if (ok) {
+        r.cells.resize(n);
+        r.pressure.resize(n);
+        ok = readAll(fds[0], r.cells.data(), n) && readAll(fds[0], r.pressure.data(), n * sizeof(double));
+    }
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    r.ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+    return r;
+}
+
+// Wall-clock throughput of one run is noisy: repeats the deterministic trial and keeps the best rate.
+TrialResult bestTrial(genfunc make, const FieldConfig& info, size_t ticks, const Parser& options, int repeats) {
+    TrialResult r = runTrial(make, info, ticks, options);
+    for (int i = 1; r.ok && i < repeats; i++) {
+        TrialResult again = runTrial(make, info, ticks, options);
+        if (again.ok) r.ticks_per_sec = std::max(r.ticks_per_sec, again.ticks_per_sec);
+    }
+    return r;
+}
+
+Accuracy compareTrial(const TrialResult& ref, const TrialResult& r, const FieldConfig& info) {
+    Accuracy acc;
+    size_t cells = 0, mismatched = 0;
+    double l2 = 0;
+    for (size_t x = 0; x < info.h; x++) {
+        for (size_t y = 0; y < info.w; y++) {
+            size_t i = x * info.w + y;
+            if (ref.cells[i] == '#') continue;
+            cells++;
+            mismatched += (ref.cells[i] != r.cells[i]);
+            double d = r.pressure[i] - ref.pressure[i];
+            l2 += d * d;
+        }
+    }
+    acc.mismatch = cells ? double(mismatched) / cells : 0;
+    acc.pressure_l2 = cells ? std::sqrt(l2 / cells) : 0;
+    return acc;
+}
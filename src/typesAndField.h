@@ -14,7 +14,7 @@ using std::array;
 #endif
 
 constexpr array t{TYPES};
-constexpr array s{DYNAMIC, SIZES};
+constexpr array s{DYNAMIC, SPARSE, SIZES};
 
 template <int num>
 using type = std::conditional_t<
@@ -28,15 +28,27 @@ using type = std::conditional_t<
         >
 >;
 
-template <typename P, typename V, typename VF, size_t N, size_t M>
+template <typename P, typename V, typename VF, int N, int M>
 std::unique_ptr<AbstractField> generateSim() {
     return std::make_unique<Field<P, V, VF, N, M>>();
 }
 
+// Sparse storage is only built for uniform P/V/VF types, every other storage for all
+// combinations: a full sparse set would add t.size()^3 instantiations to the build.
+template <int index>
+constexpr bool isCompiled() {
+    constexpr int p = t[index/(t.size()*t.size()*s.size())];
+    constexpr int v = t[index%(t.size()*t.size()*s.size())/(t.size()*s.size())];
+    constexpr int vf = t[index%(t.size()*s.size())/s.size()];
+    return s[index%s.size()].first >= 0 || (p == v && v == vf);
+}
+
 template <int index>
 constexpr auto simulatorsGenerator() {
     auto res = simulatorsGenerator<index+1>();
-    res[index] = generateSim<type<t[index/(t.size()*t.size()*s.size())]>, type<t[index%(t.size()*t.size()*s.size())/(t.size()*s.size())]>, type<t[index%(t.size()*s.size())/s.size()]>, s[index%s.size()].first, s[index%s.size()].second>;
+    if constexpr (isCompiled<index>()) {
+        res[index] = generateSim<type<t[index/(t.size()*t.size()*s.size())]>, type<t[index%(t.size()*t.size()*s.size())/(t.size()*s.size())]>, type<t[index%(t.size()*s.size())/s.size()]>, s[index%s.size()].first, s[index%s.size()].second>;
+    }
     return res;
 }
 
@@ -50,14 +62,42 @@ constexpr auto simulatorsGenerator<t.size()*t.size()*t.size()*s.size()>() {
 template <int index>
 constexpr auto typesGenerator() {
     auto res = typesGenerator<index+1>();
-    res[index] = {t[index/(t.size()*t.size()*s.size())], t[index%(t.size()*t.size()*s.size())/(t.size()*s.size())], t[index%(t.size()*s.size())/s.size()], s[index%s.size()].first, s[index%s.size()].second};
+    if constexpr (isCompiled<index>()) {
+        res[index] = {t[index/(t.size()*t.size()*s.size())], t[index%(t.size()*t.size()*s.size())/(t.size()*s.size())], t[index%(t.size()*s.size())/s.size()], s[index%s.size()].first, s[index%s.size()].second};
+    } else {
+        res[index] = {-1, -1, -1, -1, -1};
+    }
     return res;
 }
 
 template <>
 constexpr auto typesGenerator<t.size()*t.size()*t.size()*s.size()>() {
-    return array<tuple<int, int, int, size_t, size_t>, t.size()*t.size()*t.size()*s.size()>();
+    return array<tuple<int, int, int, int, int>, t.size()*t.size()*t.size()*s.size()>();
 }
 
 constexpr auto generateTypes = typesGenerator<0>;
 constexpr auto generateSimulators = simulatorsGenerator<0>;
+
+// Picks the smallest static size that fits the scene (padding the rest with walls),
+// falling back to DYNAMIC when none of them does. SPARSE is only used on request.
+template <typename Types>
+size_t findSimulator(const Types& types, int p_type, int v_type, int vf_type, size_t h, size_t w, bool sparse = false) {
+    size_t best = types.size(), dynamic = types.size();
+    for (size_t i = 0; i < types.size(); i++) {
+        auto [p, v, vf, n, k] = types[i];
+        if (p != p_type || v != v_type || vf != vf_type) continue;
+        if (n < 0) {
+            if (sparse) return i;
+            continue;
+        }
+        if (n == 0 && k == 0) {
+            dynamic = i;
+            continue;
+        }
+        if (size_t(n) < h || size_t(k) < w) continue;
+        if (best == types.size() || n * k < std::get<3>(types[best]) * std::get<4>(types[best])) {
+            best = i;
+        }
+    }
+    return sparse ? types.size() : best != types.size() ? best : dynamic;
+}
@@ -9,10 +9,8 @@ constexpr std::array<std::pair<int, int>, 4> deltas{{{-1, 0}, {1, 0}, {0, -1}, {
 template<typename T>
 T g() { return 0.1; };
 
-std::mt19937 rnd(1337);
-
 template<typename T>
-T random01() {
+T random01(std::mt19937& rnd) {
     if constexpr (std::is_same_v<T, float> or std::is_same_v<T, double>) {
         return T(rnd()) / T(std::mt19937::max());
     } else {
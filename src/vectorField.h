@@ -28,10 +28,14 @@ struct VectorField {
 
 template <typename Type, int NVal, int KVal>
 void VectorField<Type, NVal, KVal>::clear() {
-    for (size_t x = 0; x < N; x++) {
-        for (size_t y = 0; y < K; y++) {
-            for (size_t z = 0; z < deltas.size(); z++) {
-                v[x][y][z] = Type();
+    if constexpr (NVal < 0) {
+        v.clear();
+    } else {
+        for (size_t x = 0; x < N; x++) {
+            for (size_t y = 0; y < K; y++) {
+                for (size_t z = 0; z < deltas.size(); z++) {
+                    v[x][y][z] = Type();
+                }
             }
         }
     }
@@ -1,8 +1,14 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 #include <cstring>
 #include <iostream>
+#include <algorithm>
+
+#include "planeAllocator.h"
+
+constexpr int SPARSE_TILE = 16;
 
 template <typename T, int NVal, int KVal>
 struct Array {
@@ -10,28 +16,87 @@ struct Array {
 
     void init(int N, int K);
     T* operator[](int index);
+    const T* operator[](int index) const;
     Array& operator=(const Array& b);
 };
 
+// One contiguous row-major plane taken from the plane allocator.
 template <typename T>
 struct Array<T, 0, 0> {
-    std::vector<std::vector<T>> v;
+    std::vector<T, PlaneAllocator<T>> v;
+    int K = 0;
+
+    void init(int N, int K);
+    T* operator[](int index);
+    const T* operator[](int index) const;
+    Array& operator=(const Array& b);
+};
+
+// Block-sparse storage: SPARSE_TILE x SPARSE_TILE tiles are allocated on first access,
+// sealed tiles all point to one shared read-only sentinel tile. Reads through a const
+// Array do not allocate: cells of missing tiles read as T{}. Tiles are carved from chunks
+// taken from the plane allocator and recycled when a tile gets sealed.
+template <typename T>
+struct Array<T, -1, -1> {
+    static_assert(std::is_trivially_destructible_v<T>);
+    static constexpr size_t TILE_BYTES = SPARSE_TILE * SPARSE_TILE * sizeof(T);
+
+    struct Row {
+        Array& a;
+        size_t base;
+        unsigned offset;
+
+        T& operator[](int y);
+    };
+
+    struct ConstRow {
+        const Array& a;
+        size_t base;
+        unsigned offset;
+
+        const T& operator[](int y) const;
+    };
+
+    static inline const T missing{};
+
+    int N = 0, K = 0, TN = 0, TK = 0;
+    std::vector<T*> storage;
+    std::vector<T*> tiles;
+    T* sentinel = nullptr;
+    std::vector<std::pair<T*, size_t>> chunks;
+    std::vector<T*> spare;
+
+    Array() = default;
+    Array(const Array&) = delete;
+    ~Array();
+
+    T* acquire();
+    void release(T*& tile);
 
     void init(int N, int K);
-    std::vector<T>& operator[](int index);
+    Row operator[](int index);
+    ConstRow operator[](int index) const;
     Array& operator=(const Array& b);
+
+    void seal(const T& solid);
+    bool sealed(int x, int tile_y) const;
+    void unseal(int x, int y);
+    void clear();
+    size_t allocated() const;
+    size_t solid() const;
 };
 
 
 
 template <typename T, int NVal, int KVal>
 void Array<T, NVal, KVal>::init(int N, int K) {
-    if (N != NVal || K != KVal) {std::cout << "Wrong size of field\n"; throw std::exception();}
+    if (N > NVal || K > KVal) {std::cout << "Wrong size of field\n"; throw std::exception();}
 }
 
 template <typename T>
 void Array<T, 0, 0>::init(int N, int K) {
-    v.resize(N, std::vector<T>(K));
+    this->K = K;
+    v.assign(size_t(N) * K, T{});
 }
 
 template <typename T, int NVal, int KVal>
@@ -40,10 +105,20 @@ T* Array<T, NVal, KVal>::operator[](int index) {
 }
 
 template <typename T>
-std::vector<T>& Array<T, 0, 0>::operator[](int index) {
+T* Array<T, 0, 0>::operator[](int index) {
+    return v.data() + size_t(index) * K;
+}
+
+template <typename T, int NVal, int KVal>
+const T* Array<T, NVal, KVal>::operator[](int index) const {
     return v[index];
 }
 
+template <typename T>
+const T* Array<T, 0, 0>::operator[](int index) const {
+    return v.data() + size_t(index) * K;
+}
+
 
 template <typename T, int NVal, int KVal>
 Array<T, NVal, KVal>& Array<T, NVal, KVal>::operator=(const Array& other) {
@@ -55,5 +130,155 @@ Array<T, NVal, KVal>& Array<T, NVal, KVal>::operator=(const Array& other) {
 template <typename T>
 Array<T, 0, 0>& Array<T, 0, 0>::operator=(const Array& other) {
     v = other.v;
+    K = other.K;
+    return *this;
+}
+
+
+template <typename T>
+Array<T, -1, -1>::~Array() {
+    for (auto [chunk, count]: chunks) {
+        freePlane(chunk, count * TILE_BYTES);
+    }
+}
+
+template <typename T>
+T* Array<T, -1, -1>::acquire() {
+    if (spare.empty()) {
+        size_t count = planeMemory.huge_pages ? std::max<size_t>(1, HUGE_PAGE_SIZE / TILE_BYTES) : 16;
+        T* chunk = static_cast<T*>(allocatePlane(count * TILE_BYTES));
+        chunks.emplace_back(chunk, count);
+        for (size_t i = count; i-- > 0;) {
+            spare.push_back(chunk + i * SPARSE_TILE * SPARSE_TILE);
+        }
+    }
+    T* tile = spare.back();
+    spare.pop_back();
+    std::uninitialized_fill_n(tile, SPARSE_TILE * SPARSE_TILE, T{});
+    return tile;
+}
+
+template <typename T>
+void Array<T, -1, -1>::release(T*& tile) {
+    if (tile) {spare.push_back(tile);}
+    tile = nullptr;
+}
+
+template <typename T>
+void Array<T, -1, -1>::init(int N, int K) {
+    this->N = N; this->K = K;
+    TN = (N + SPARSE_TILE - 1) / SPARSE_TILE;
+    TK = (K + SPARSE_TILE - 1) / SPARSE_TILE;
+    for (auto& tile: storage) {
+        release(tile);
+    }
+    storage.assign(size_t(TN) * TK, nullptr);
+    tiles.assign(size_t(TN) * TK, nullptr);
+}
+
+template <typename T>
+T& Array<T, -1, -1>::Row::operator[](int y) {
+    size_t i = base + unsigned(y) / SPARSE_TILE;
+    T* tile = a.tiles[i];
+    if (!tile) [[unlikely]] {
+        tile = a.tiles[i] = a.storage[i] = a.acquire();
+    }
+    return tile[offset + unsigned(y) % SPARSE_TILE];
+}
+
+template <typename T>
+const T& Array<T, -1, -1>::ConstRow::operator[](int y) const {
+    const T* tile = a.tiles[base + unsigned(y) / SPARSE_TILE];
+    return tile ? tile[offset + unsigned(y) % SPARSE_TILE] : missing;
+}
+
+template <typename T>
+typename Array<T, -1, -1>::Row Array<T, -1, -1>::operator[](int index) {
+    return Row{*this, size_t(unsigned(index) / SPARSE_TILE) * TK, unsigned(index) % SPARSE_TILE * SPARSE_TILE};
+}
+
+template <typename T>
+typename Array<T, -1, -1>::ConstRow Array<T, -1, -1>::operator[](int index) const {
+    return ConstRow{*this, size_t(unsigned(index) / SPARSE_TILE) * TK, unsigned(index) % SPARSE_TILE * SPARSE_TILE};
+}
+
+template <typename T>
+Array<T, -1, -1>& Array<T, -1, -1>::operator=(const Array& other) {
+    if (this == &other) {return *this;}
+    if (N != other.N || K != other.K) {init(other.N, other.K);}
+    if (other.sentinel) {
+        if (!sentinel) {sentinel = acquire();}
+        std::copy_n(other.sentinel, SPARSE_TILE * SPARSE_TILE, sentinel);
+    }
+    for (size_t i = 0; i < tiles.size(); i++) {
+        if (!other.tiles[i]) {
+            if (storage[i]) {std::fill_n(storage[i], SPARSE_TILE * SPARSE_TILE, T{});}
+        } else if (other.tiles[i] == other.sentinel) {
+            release(storage[i]);
+            tiles[i] = sentinel;
+        } else {
+            if (!storage[i]) {storage[i] = acquire();}
+            tiles[i] = storage[i];
+            std::copy_n(other.tiles[i], SPARSE_TILE * SPARSE_TILE, tiles[i]);
+        }
+    }
     return *this;
-}
\ No newline at end of file
+}
+
+template <typename T>
+void Array<T, -1, -1>::seal(const T& solid) {
+    if (!sentinel) {sentinel = acquire();}
+    std::fill_n(sentinel, SPARSE_TILE * SPARSE_TILE, solid);
+    for (int tx = 0; tx < TN; tx++) {
+        for (int ty = 0; ty < TK; ty++) {
+            size_t i = size_t(tx) * TK + ty;
+            if (!storage[i]) {continue;}
+            bool all_solid = true;
+            for (int x = tx * SPARSE_TILE; x < std::min(N, (tx + 1) * SPARSE_TILE) && all_solid; x++) {
+                for (int y = ty * SPARSE_TILE; y < std::min(K, (ty + 1) * SPARSE_TILE); y++) {
+                    if (!(storage[i][(x % SPARSE_TILE) * SPARSE_TILE + y % SPARSE_TILE] == solid)) {
+                        all_solid = false;
+                        break;
+                    }
+                }
+            }
+            if (all_solid) {
+                release(storage[i]);
+                tiles[i] = sentinel;
+            }
+        }
+    }
+}
+
+template <typename T>
+bool Array<T, -1, -1>::sealed(int x, int tile_y) const {
+    const T* tile = tiles[size_t(x / SPARSE_TILE) * TK + tile_y];
+    return tile && tile == sentinel;
+}
+
+template <typename T>
+void Array<T, -1, -1>::unseal(int x, int y) {
+    size_t i = size_t(unsigned(x) / SPARSE_TILE) * TK + unsigned(y) / SPARSE_TILE;
+    if (tiles[i] && tiles[i] == sentinel) {
+        storage[i] = acquire();
+        std::copy_n(sentinel, SPARSE_TILE * SPARSE_TILE, storage[i]);
+        tiles[i] = storage[i];
+    }
+}
+
+template <typename T>
+void Array<T, -1, -1>::clear() {
+    for (auto& tile: storage) {
+        if (tile) {std::fill_n(tile, SPARSE_TILE * SPARSE_TILE, T{});}
+    }
+}
+
+template <typename T>
+size_t Array<T, -1, -1>::allocated() const {
+    return std::count_if(storage.begin(), storage.end(), [](auto& tile) {return tile != nullptr;});
+}
+
+template <typename T>
+size_t Array<T, -1, -1>::solid() const {
+    return sentinel ? std::count(tiles.begin(), tiles.end(), sentinel) : 0;
+}